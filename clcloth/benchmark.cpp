@@ -0,0 +1,520 @@
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include <assert.h>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#include <OpenCL/cl.h>
+#elif WIN32
+#include <Windows.h>
+#include <CL/opencl.h>
+#pragma comment (lib, "opencl.lib")
+#else
+#include <CL/opencl.h>
+#endif
+
+#include "config.h"
+
+// Micro-benchmark of the kernels in kernel.cl. Each kernel runs on its own
+// over a synthetic cloth, for a range of cloth sizes, block sizes and with
+// and without local memory. The achieved bandwidth and arithmetic rate are
+// printed as JSON, next to the copy bandwidth of the device as the ceiling.
+
+const int WARMUP_RUNS = 3;
+const int TIMED_RUNS = 21;
+const size_t COPY_BYTES = 64 << 20;
+
+const size_t CLOTH_SIZES[] = {64, 128, 256, 512};
+const size_t BLOCK_SIZES[] = {1, 4, 8, 16};
+
+// Traffic and arithmetic per node, from the stencils in kernel.cl. Bytes
+// count every input node read once and every output written once, which is
+// the least any schedule can move. Flops count a float4 operation as four,
+// sqrt and division as one, and leave out the collisions, which depend on
+// the scene.
+struct KernelCost
+{
+    const char* name;
+    int bytes;
+    int flops;
+};
+
+const KernelCost KERNEL_COSTS[] =
+{
+    // two scalings, a subtraction and the gravity per component
+    {"advance", 3 * 16, 4 * 4},
+    // 12 constraints: delta 4, length 8, difference 2, scaling 8 and the
+    // accumulation 4, then the final add
+    {"constrainInterior", 2 * 16, 12 * 26 + 4},
+    {"constrainBoundary", 2 * 16, 12 * 26 + 4},
+    // 8 differences, 4 cross products of 9, their sum, length and division
+    {"calculateNormalsInterior", 2 * 16, 8 * 4 + 4 * 9 + 3 * 4 + 8 + 4},
+    {"calculateNormalsBoundary", 2 * 16, 8 * 4 + 4 * 9 + 3 * 4 + 8 + 4},
+    // a quarter of a coarse node per dense node; 5 Catmull-Rom evaluations
+    // of 17 float4 operations and a scalar multiply
+    {"refine", 16 / 4 + 16, 5 * (17 * 4 + 1)},
+    // the row kernels keep 3 floats per node and skip the w component
+    {"advanceRows", 3 * 12, 3 * 4},
+    {"constrainRows", 2 * 12, 12 * 20 + 3},
+    {"calculateNormalsRows", 12 + 2 * 16, 4 * 3 + 4 * 12 + 6 + 3},
+    {"refineRows", 12 / 4 + 16, 5 * (17 * 4 + 1)},
+};
+
+// One build of kernel.cl. A block size of 0 leaves the local size to the
+// implementation.
+struct Variant
+{
+    const char* layout;
+    size_t size;
+    size_t blockSize;
+    bool localMemory;
+};
+
+class KernelBenchmark
+{
+public:
+    KernelBenchmark();
+    ~KernelBenchmark();
+    
+    void init();
+    void run(std::ostream& out);
+    
+private:
+    void uninit();
+    
+    cl_program build(const std::string& definitions) const;
+    std::string readLines(const std::string& filename) const;
+    
+    cl_mem createBuffer(void* data, size_t size) const;
+    cl_kernel createKernel(cl_program program, const char* name, cl_mem first, cl_mem second, cl_mem third = 0) const;
+    
+    double measureCopyBandwidth() const;
+    double duration(cl_event event) const;
+    void measure(const Variant& variant, cl_kernel kernel, cl_uint dimensions, const size_t* offsets, const size_t* globalSizes, const size_t* groupSizes, size_t nodes);
+    
+    void benchmarkNodes(size_t size, size_t blockSize, bool localMemory);
+    void benchmarkRows(size_t size);
+    void benchmarkRefine(size_t size);
+    
+    cl_context context;
+    cl_device_id device;
+    cl_command_queue commandQueue;
+    std::string deviceName;
+    double copyBandwidth;
+    std::vector<std::string> results;
+};
+
+// A rippled sheet at the start position of the simulation, so that the
+// constraints have work to do. The phase shifts the ripple for old positions.
+std::vector<cl_float4> createCloth(size_t size, float phase)
+{
+    std::vector<cl_float4> nodes(size * size);
+    for (std::size_t i = 0; i != nodes.size(); ++i)
+    {
+        float x = float(i % size);
+        float y = float(i / size);
+        nodes[i].s[0] = x / size * CLOTH_SCALE - 0.5f * CLOTH_SCALE + CLOTH_START_X;
+        nodes[i].s[1] = y / size * CLOTH_SCALE - 0.5f * CLOTH_SCALE + CLOTH_START_Y;
+        nodes[i].s[2] = CLOTH_START_Z + 0.5f * std::sin(0.3f * x + phase) * std::cos(0.2f * y);
+        nodes[i].s[3] = 1.0f;
+    }
+    return nodes;
+}
+
+// Same layout as Cloth::toRows in main.cpp.
+std::vector<cl_float> toRows(const std::vector<cl_float4>& nodes, size_t size)
+{
+    std::vector<cl_float> rows(3 * ROW_PLANE_SIZE_AT(size), 0.0f);
+    for (std::size_t i = 0; i != nodes.size(); ++i)
+    {
+        std::size_t x = i % size;
+        std::size_t y = i / size;
+        std::size_t id = (y + BORDER) * ROW_PITCH_AT(size) + ROW_VECTOR_WIDTH + x;
+        for (int plane = 0; plane != 3; ++plane)
+            rows[plane * ROW_PLANE_SIZE_AT(size) + id] = nodes[i].s[plane];
+    }
+    return rows;
+}
+
+// INTERIOR_MARGIN_AT for a block size other than the configured one.
+size_t interiorMargin(size_t size, size_t blockSize)
+{
+    return BORDER + ((size - 2 * BORDER) % blockSize) / 2;
+}
+
+const KernelCost& getCost(const std::string& name)
+{
+    for (std::size_t i = 0; i != sizeof(KERNEL_COSTS) / sizeof(KERNEL_COSTS[0]); ++i)
+    {
+        if (name == KERNEL_COSTS[i].name)
+            return KERNEL_COSTS[i];
+    }
+    assert(!"no cost for kernel");
+    return KERNEL_COSTS[0];
+}
+
+std::string quote(const std::string& text)
+{
+    std::string result = "\"";
+    for (std::size_t i = 0; i != text.size(); ++i)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+            result += '\\';
+        result += text[i];
+    }
+    return result + "\"";
+}
+
+KernelBenchmark::KernelBenchmark()
+    : context(0)
+    , device(0)
+    , commandQueue(0)
+    , copyBandwidth(0.0)
+{
+}
+
+KernelBenchmark::~KernelBenchmark()
+{
+    uninit();
+}
+
+void KernelBenchmark::init()
+{
+    cl_int error = 0;
+    cl_platform_id platform;
+    cl_uint platform_amount;
+    
+    error = clGetPlatformIDs(1, &platform, &platform_amount);
+    assert(!error);
+    
+    error = clGetDeviceIDs(platform, DEVICE_TYPE, 1, &device, NULL);
+    assert(!error);
+    
+    context = clCreateContext(0, 1, &device, NULL, NULL, &error);
+    assert(!error);
+    
+    commandQueue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &error);
+    assert(!error);
+    
+    char name[256] = {0};
+    error = clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+    assert(!error);
+    deviceName = name;
+}
+
+void KernelBenchmark::uninit()
+{
+    if (commandQueue)
+        clReleaseCommandQueue(commandQueue);
+    if (context)
+        clReleaseContext(context);
+}
+
+void KernelBenchmark::run(std::ostream& out)
+{
+    copyBandwidth = measureCopyBandwidth();
+    
+    for (std::size_t i = 0; i != sizeof(CLOTH_SIZES) / sizeof(CLOTH_SIZES[0]); ++i)
+    {
+        for (std::size_t j = 0; j != sizeof(BLOCK_SIZES) / sizeof(BLOCK_SIZES[0]); ++j)
+        {
+            benchmarkNodes(CLOTH_SIZES[i], BLOCK_SIZES[j], false);
+            benchmarkNodes(CLOTH_SIZES[i], BLOCK_SIZES[j], true);
+        }
+        benchmarkRows(CLOTH_SIZES[i]);
+        benchmarkRefine(CLOTH_SIZES[i]);
+    }
+    
+    out << std::fixed << std::setprecision(3);
+    out << "{\n";
+    out << "  \"device\": " << quote(deviceName) << ",\n";
+    out << "  \"row_vector_width\": " << ROW_VECTOR_WIDTH << ",\n";
+    out << "  \"copy_gbps\": " << copyBandwidth * 1e-9 << ",\n";
+    out << "  \"results\": [\n";
+    for (std::size_t i = 0; i != results.size(); ++i)
+        out << "    " << results[i] << (i + 1 != results.size() ? ",\n" : "\n");
+    out << "  ]\n";
+    out << "}\n";
+}
+
+cl_program KernelBenchmark::build(const std::string& definitions) const
+{
+    cl_program program;
+    
+    std::string lines = readLines("kernel.cl");
+    
+    cl_int error = 0;
+    size_t size = cl_uint(lines.size());
+    const char* start = &lines[0];
+    program = clCreateProgramWithSource(context, 1, (const char**)&start, (const size_t*)&size, &error);
+    
+    // the options of ClothSim::build, plus the variant
+    std::ostringstream options;
+    options << "-cl-denorms-are-zero -cl-strict-aliasing -cl-fast-relaxed-math -cl-mad-enable -cl-no-signed-zeros";
+    options << definitions;
+    error = clBuildProgram(program, 1, &device, options.str().c_str(), NULL, NULL);
+    assert(!error);
+    
+    return program;
+}
+
+std::string KernelBenchmark::readLines(const std::string& filename) const
+{
+    std::ifstream file(filename.c_str());
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+cl_mem KernelBenchmark::createBuffer(void* data, size_t size) const
+{
+    cl_int error = 0;
+    cl_mem buffer = clCreateBuffer(context, data ? CL_MEM_COPY_HOST_PTR : CL_MEM_READ_WRITE, size, data, &error);
+    assert(!error);
+    return buffer;
+}
+
+cl_kernel KernelBenchmark::createKernel(cl_program program, const char* name, cl_mem first, cl_mem second, cl_mem third) const
+{
+    cl_int error = 0;
+    cl_kernel kernel = clCreateKernel(program, name, &error);
+    assert(!error);
+    
+    error = clSetKernelArg(kernel, 0, sizeof(cl_mem), &first);
+    assert(!error);
+    error = clSetKernelArg(kernel, 1, sizeof(cl_mem), &second);
+    assert(!error);
+    if (third)
+    {
+        error = clSetKernelArg(kernel, 2, sizeof(cl_mem), &third);
+        assert(!error);
+    }
+    return kernel;
+}
+
+// Best of the timed runs; a copy reads and writes every byte.
+double KernelBenchmark::measureCopyBandwidth() const
+{
+    cl_mem source = createBuffer(NULL, COPY_BYTES);
+    cl_mem target = createBuffer(NULL, COPY_BYTES);
+    
+    double best = 0.0;
+    for (int i = 0; i != WARMUP_RUNS + TIMED_RUNS; ++i)
+    {
+        cl_event event;
+        cl_int error = clEnqueueCopyBuffer(commandQueue, source, target, 0, 0, COPY_BYTES, 0, NULL, &event);
+        assert(!error);
+        double seconds = duration(event);
+        if (i >= WARMUP_RUNS && (best == 0.0 || seconds < best))
+            best = seconds;
+    }
+    
+    clReleaseMemObject(source);
+    clReleaseMemObject(target);
+    return 2.0 * COPY_BYTES / best;
+}
+
+// Waits for the event and releases it.
+double KernelBenchmark::duration(cl_event event) const
+{
+    cl_int error = clWaitForEvents(1, &event);
+    assert(!error);
+    
+    cl_ulong start = 0;
+    cl_ulong end = 0;
+    error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    assert(!error);
+    error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+    assert(!error);
+    clReleaseEvent(event);
+    
+    return (end - start) * 1e-9;
+}
+
+// Times the median run of the kernel, adds its result and releases it.
+// Variants whose groups are too large for the kernel on this device are left
+// out of the results.
+void KernelBenchmark::measure(const Variant& variant, cl_kernel kernel, cl_uint dimensions, const size_t* offsets, const size_t* globalSizes, const size_t* groupSizes, size_t nodes)
+{
+    cl_int error = 0;
+    char name[256] = {0};
+    error = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name) - 1, name, NULL);
+    assert(!error);
+    
+    size_t maxGroupSize = 0;
+    error = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(maxGroupSize), &maxGroupSize, NULL);
+    assert(!error);
+    if (groupSizes && groupSizes[0] * groupSizes[1] > maxGroupSize)
+    {
+        std::cerr << "skipping " << name << " with " << variant.blockSize << "x" << variant.blockSize << " groups" << std::endl;
+        clReleaseKernel(kernel);
+        return;
+    }
+    
+    std::vector<double> durations;
+    for (int i = 0; i != WARMUP_RUNS + TIMED_RUNS; ++i)
+    {
+        cl_event event;
+        error = clEnqueueNDRangeKernel(commandQueue, kernel, dimensions, offsets, globalSizes, groupSizes, 0, NULL, &event);
+        assert(!error);
+        double seconds = duration(event);
+        if (i >= WARMUP_RUNS)
+            durations.push_back(seconds);
+    }
+    clReleaseKernel(kernel);
+    
+    std::sort(durations.begin(), durations.end());
+    double seconds = durations[durations.size() / 2];
+    
+    const KernelCost& cost = getCost(name);
+    double bytes = double(cost.bytes) * nodes;
+    double flops = double(cost.flops) * nodes;
+    
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "{\"kernel\": " << quote(name);
+    ss << ", \"layout\": " << quote(variant.layout);
+    ss << ", \"size\": " << variant.size;
+    if (variant.blockSize)
+        ss << ", \"block_size\": " << variant.blockSize;
+    else
+        ss << ", \"block_size\": null";
+    ss << ", \"local_memory\": " << (variant.localMemory ? "true" : "false");
+    ss << ", \"nodes\": " << nodes;
+    ss << ", \"bytes\": " << std::setprecision(0) << bytes;
+    ss << ", \"flops\": " << flops << std::setprecision(3);
+    ss << ", \"time_us\": " << seconds * 1e6;
+    ss << ", \"gbps\": " << bytes / seconds * 1e-9;
+    ss << ", \"gflops\": " << flops / seconds * 1e-9;
+    ss << ", \"copy_fraction\": " << bytes / seconds / copyBandwidth << "}";
+    results.push_back(ss.str());
+}
+
+void KernelBenchmark::benchmarkNodes(size_t size, size_t blockSize, bool localMemory)
+{
+    std::ostringstream definitions;
+    definitions << " -D BENCHMARK_CLOTH_SIZE=" << size;
+    definitions << " -D BENCHMARK_BLOCK_SIZE=" << blockSize;
+    definitions << " -D BENCHMARK_LOCAL_MEMORY=" << (localMemory ? 1 : 0);
+    cl_program program = build(definitions.str());
+    
+    std::vector<cl_float4> oldNodes = createCloth(size, 0.1f);
+    std::vector<cl_float4> nodes = createCloth(size, 0.0f);
+    size_t nodesSize = nodes.size() * sizeof(cl_float4);
+    cl_mem oldPositions = createBuffer(&oldNodes[0], nodesSize);
+    cl_mem positions = createBuffer(&nodes[0], nodesSize);
+    cl_mem output = createBuffer(NULL, nodesSize);
+    
+    size_t margin = interiorMargin(size, blockSize);
+    size_t interior = size - 2 * margin;
+    size_t boundary = size * size - interior * interior;
+    size_t dimensions[] = {size, size};
+    size_t groupSizes[] = {blockSize, blockSize};
+    size_t interiorOffsets[] = {margin, margin};
+    size_t interiorDimensions[] = {interior, interior};
+    size_t boundaryDimensions[] = {boundary};
+    
+    Variant variant = {"float4", size, blockSize, localMemory};
+    
+    cl_kernel kernel = createKernel(program, "advance", oldPositions, positions, output);
+    measure(variant, kernel, 2, NULL, dimensions, groupSizes, size * size);
+    
+    kernel = createKernel(program, "constrainInterior", positions, output);
+    cl_int error = clSetKernelArg(kernel, 2, sizeof(cl_float4) * (blockSize + 2 * BORDER) * (blockSize + 2 * BORDER), NULL);
+    assert(!error);
+    measure(variant, kernel, 2, interiorOffsets, interiorDimensions, groupSizes, interior * interior);
+    
+    kernel = createKernel(program, "constrainBoundary", positions, output);
+    measure(variant, kernel, 1, NULL, boundaryDimensions, NULL, boundary);
+    
+    kernel = createKernel(program, "calculateNormalsInterior", positions, output);
+    measure(variant, kernel, 2, interiorOffsets, interiorDimensions, groupSizes, interior * interior);
+    
+    kernel = createKernel(program, "calculateNormalsBoundary", positions, output);
+    measure(variant, kernel, 1, NULL, boundaryDimensions, NULL, boundary);
+    
+    clReleaseMemObject(oldPositions);
+    clReleaseMemObject(positions);
+    clReleaseMemObject(output);
+    clReleaseProgram(program);
+}
+
+void KernelBenchmark::benchmarkRows(size_t size)
+{
+    std::ostringstream definitions;
+    definitions << " -D BENCHMARK_CLOTH_SIZE=" << size;
+    cl_program program = build(definitions.str());
+    
+    std::vector<cl_float> oldRows = toRows(createCloth(size, 0.1f), size);
+    std::vector<cl_float> rows = toRows(createCloth(size, 0.0f), size);
+    size_t rowsSize = rows.size() * sizeof(cl_float);
+    size_t verticesSize = size * size * sizeof(cl_float4);
+    cl_mem oldPositions = createBuffer(&oldRows[0], rowsSize);
+    cl_mem positions = createBuffer(&rows[0], rowsSize);
+    cl_mem output = createBuffer(&rows[0], rowsSize);
+    cl_mem normals = createBuffer(NULL, verticesSize);
+    cl_mem vertices = createBuffer(NULL, verticesSize);
+    
+    size_t dimensions[] = {size / ROW_VECTOR_WIDTH, size};
+    
+    Variant variant = {"rows", size, 0, false};
+    
+    cl_kernel kernel = createKernel(program, "advanceRows", oldPositions, positions, output);
+    measure(variant, kernel, 2, NULL, dimensions, NULL, size * size);
+    
+    kernel = createKernel(program, "constrainRows", positions, output);
+    measure(variant, kernel, 2, NULL, dimensions, NULL, size * size);
+    
+    kernel = createKernel(program, "calculateNormalsRows", positions, normals, vertices);
+    measure(variant, kernel, 2, NULL, dimensions, NULL, size * size);
+    
+    clReleaseMemObject(oldPositions);
+    clReleaseMemObject(positions);
+    clReleaseMemObject(output);
+    clReleaseMemObject(normals);
+    clReleaseMemObject(vertices);
+    clReleaseProgram(program);
+}
+
+// Refinement from the first coarse level, for both layouts.
+void KernelBenchmark::benchmarkRefine(size_t size)
+{
+    std::ostringstream definitions;
+    definitions << " -D BENCHMARK_CLOTH_SIZE=" << size;
+    definitions << " -D SIMULATION_LEVEL=1";
+    cl_program program = build(definitions.str());
+    
+    size_t gridSize = size / 2;
+    std::vector<cl_float4> nodes = createCloth(gridSize, 0.0f);
+    std::vector<cl_float> rows = toRows(nodes, gridSize);
+    cl_mem positions = createBuffer(&nodes[0], nodes.size() * sizeof(cl_float4));
+    cl_mem positionRows = createBuffer(&rows[0], rows.size() * sizeof(cl_float));
+    cl_mem vertices = createBuffer(NULL, size * size * sizeof(cl_float4));
+    
+    size_t dimensions[] = {size, size};
+    
+    Variant variant = {"float4", size, 0, false};
+    cl_kernel kernel = createKernel(program, "refine", positions, vertices);
+    measure(variant, kernel, 2, NULL, dimensions, NULL, size * size);
+    
+    variant.layout = "rows";
+    kernel = createKernel(program, "refineRows", positionRows, vertices);
+    measure(variant, kernel, 2, NULL, dimensions, NULL, size * size);
+    
+    clReleaseMemObject(positions);
+    clReleaseMemObject(positionRows);
+    clReleaseMemObject(vertices);
+    clReleaseProgram(program);
+}
+
+int main()
+{
+    KernelBenchmark benchmark;
+    benchmark.init();
+    benchmark.run(std::cout);
+    return 0;
+}
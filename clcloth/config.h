@@ -8,6 +8,7 @@
 #define SOLVER_ITERATIONS 1
 #define SOLVER_DAMPING 0.0f
 #define ENABLE_SPHERE_COLLISION 1
+#define SIMULATION_LEVELS 2
 #endif
 
 // 128x128 on sphere
@@ -17,6 +18,7 @@
 //#define SOLVER_DAMPING 0.0f
 #define SOLVER_DAMPING 0.02f
 #define ENABLE_SPHERE_COLLISION 1
+#define SIMULATION_LEVELS 3
 #endif
 
 // 128x128 on round table
@@ -25,6 +27,7 @@
 #define SOLVER_ITERATIONS 9
 #define SOLVER_DAMPING 0.02f
 #define ENABLE_CYLINDER_COLLISION 1
+#define SIMULATION_LEVELS 3
 #endif
 
 // 128x128 on cube
@@ -33,6 +36,7 @@
 #define SOLVER_ITERATIONS 9
 #define SOLVER_DAMPING 0.02f
 #define ENABLE_CUBE_COLLISION 1
+#define SIMULATION_LEVELS 3
 #endif
 
 
@@ -48,6 +52,9 @@
 #define USE_LOCAL_MEMORY
 #endif
 
+// nodes per work-item in the row kernels picked for CPU devices (8 or 16)
+#define ROW_VECTOR_WIDTH 8
+
 // collision shapes
 #define CYLINDER_RADIUS 14.0f
 #define CYLINDER_HEIGHT -2.0f
@@ -79,9 +86,60 @@
 #define CAMERA_FOV 67.5f
 
 
+// the benchmark rebuilds the kernels with other sizes and device settings
+#ifdef BENCHMARK_CLOTH_SIZE
+#undef CLOTH_SIZE
+#define CLOTH_SIZE BENCHMARK_CLOTH_SIZE
+#endif
+#ifdef BENCHMARK_BLOCK_SIZE
+#undef BLOCK_SIZE
+#define BLOCK_SIZE BENCHMARK_BLOCK_SIZE
+#endif
+#ifdef BENCHMARK_LOCAL_MEMORY
+#undef USE_LOCAL_MEMORY
+#if BENCHMARK_LOCAL_MEMORY
+#define USE_LOCAL_MEMORY
+#endif
+#endif
+
+
 // internal stuff
 #define BORDER 2
 #define TEMP_SIZE (BLOCK_SIZE + 2 * BORDER)
 
+// level of detail: the program for level n simulates a GRID_SIZE grid of
+// CLOTH_SIZE >> n nodes per side, spread over the same cloth, and refines
+// it back to CLOTH_SIZE for display; the host builds one per level
+#ifndef SIMULATION_LEVEL
+#define SIMULATION_LEVEL 0
+#endif
+#define GRID_SIZE_AT(level) (CLOTH_SIZE >> (level))
+#define GRID_SIZE GRID_SIZE_AT(SIMULATION_LEVEL)
+#define GRID_SPACING (CLOTH_SCALE / CLOTH_SIZE * ((CLOTH_SIZE - 1) / (GRID_SIZE - 1.0f)))
+
+// nodes at least INTERIOR_MARGIN away from the edges have their whole stencil
+// inside the grid; the margin is widened so the interior is whole blocks
+#define INTERIOR_MARGIN_AT(size) (BORDER + (((size) - 2 * BORDER) % BLOCK_SIZE) / 2)
+#define INTERIOR_SIZE_AT(size) ((size) - 2 * INTERIOR_MARGIN_AT(size))
+#define BOUNDARY_NODES_AT(size) ((size) * (size) - INTERIOR_SIZE_AT(size) * INTERIOR_SIZE_AT(size))
+#define INTERIOR_MARGIN INTERIOR_MARGIN_AT(GRID_SIZE)
+#define INTERIOR_SIZE INTERIOR_SIZE_AT(GRID_SIZE)
+#define BOUNDARY_NODES BOUNDARY_NODES_AT(GRID_SIZE)
+
+#if ((GRID_SIZE - 2 * BORDER) % BLOCK_SIZE) % 2 != 0 || INTERIOR_SIZE <= 0
+#error "GRID_SIZE can't be split into an interior of whole blocks"
+#endif
+
+// the row kernels keep x, y and z in separate planes with a padded apron,
+// so that every run of neighbours in the stencil can be loaded whole
+#define ROW_PITCH_AT(size) ((size) + 2 * ROW_VECTOR_WIDTH)
+#define ROW_PLANE_SIZE_AT(size) (ROW_PITCH_AT(size) * ((size) + 2 * BORDER))
+#define ROW_PITCH ROW_PITCH_AT(GRID_SIZE)
+#define ROW_PLANE_SIZE ROW_PLANE_SIZE_AT(GRID_SIZE)
+
+#if GRID_SIZE % ROW_VECTOR_WIDTH != 0
+#error "GRID_SIZE must be a multiple of ROW_VECTOR_WIDTH"
+#endif
+
 
 #endif
@@ -6,9 +6,9 @@ __kernel void advance(__global float4* old_positions,
 {
     int x = get_global_id(0);
     int y = get_global_id(1);
-    size_t id = y * CLOTH_SIZE + x;
+    size_t id = y * GRID_SIZE + x;
     
-    if (x < 0 || y < 0 || x >= CLOTH_SIZE || y >= CLOTH_SIZE)
+    if (x < 0 || y < 0 || x >= GRID_SIZE || y >= GRID_SIZE)
         return;
     
     float4 gravity = {0.0f, 0.0f, SOLVER_GRAVITY, 0.0f};
@@ -29,92 +29,8 @@ float4 satisfy_constraint(float4 first, float4 second, float rest_distance)
     return delta * stiffness * difference;
 }
 
-#ifdef USE_LOCAL_MEMORY
-
-#define fill(x_offset, y_offset)\
-    temp[(local_y + y_offset + BORDER) + (local_x + x_offset + BORDER) * TEMP_SIZE] = unconstrained[(y + y_offset) * (CLOTH_SIZE) + (x + x_offset)];
-#define lookup(x_offset, y_offset)\
-    temp[(local_y + y_offset + BORDER) + (local_x + x_offset + BORDER) * TEMP_SIZE]
-
-#else
-
-#define fill(x_offset, y_offset)
-#define lookup(x_offset, y_offset)\
-    unconstrained[(y + y_offset) * (CLOTH_SIZE) + (x + x_offset)]
-
-#endif
-
-__kernel void constrain(__global float4* unconstrained,
-                        __global float4* positions,
-                        __local float4* temp)
+float4 collide(float4 output)
 {
-    int x = get_global_id(0);
-    int y = get_global_id(1);
-    size_t id = y * (CLOTH_SIZE) + x;
-    
-    if (x < 0 || y < 0 || x >= CLOTH_SIZE || y >= CLOTH_SIZE)
-        return;
-    
-    const float scale = CLOTH_SCALE / CLOTH_SIZE;
-    
-    int local_x = get_local_id(0);
-    int local_y = get_local_id(1);
-
-    if (x + BORDER < CLOTH_SIZE && y + BORDER < CLOTH_SIZE)
-        fill(+BORDER, +BORDER);
-    if (local_x <= BORDER + 1 && local_y <= BORDER + 1 && x - BORDER >= 0 && y - BORDER >= 0)
-        fill(-BORDER, -BORDER);
-    if (local_y <= BORDER + 1 && x + BORDER < CLOTH_SIZE && y - BORDER >= 0)
-        fill(+BORDER, -BORDER);
-    if (local_x <= BORDER + 1 && x - BORDER >= 0 && y + BORDER < CLOTH_SIZE)
-        fill(-BORDER, +BORDER);
-
-    barrier(CLK_LOCAL_MEM_FENCE);
-    
-    float4 output = unconstrained[id];
-
-    float4 dx = {0.0f, 0.0f, 0.0f, 0.0f};
-    
-	// straight distance constraints: prevents stretching
-    
-	const float straight_distance = 1.0f * scale;
-	
-	if (x > 0)
-        dx += satisfy_constraint(output, lookup(-1,  0), straight_distance);
-	if (x < (CLOTH_SIZE - 1))
-		dx += satisfy_constraint(output, lookup(+1,  0), straight_distance);
-	if (y < (CLOTH_SIZE - 1))
-		dx += satisfy_constraint(output, lookup( 0, +1), straight_distance);
-	if (y > 0)
-		dx += satisfy_constraint(output, lookup( 0, -1), straight_distance);
-    
-	// diagonal distance constraints: prevents shearing
-    
-	const float diagonal_distance = sqrt(2.0f) * scale;
-    
-	if (x > 0 && y > 0)
-		dx += satisfy_constraint(output, lookup(-1, -1), diagonal_distance);
-	if (x < (CLOTH_SIZE - 1) && y > 0)
-		dx += satisfy_constraint(output, lookup(+1, -1), diagonal_distance);
-	if (x > 0 && y < (CLOTH_SIZE - 1))
-		dx += satisfy_constraint(output, lookup(-1, +1), diagonal_distance);
-	if (x < (CLOTH_SIZE - 1) && y < (CLOTH_SIZE - 1))
-		dx += satisfy_constraint(output, lookup(+1, +1), diagonal_distance);
-	
-	// double diagonal distance constraints: prevents folding
-	const float double_diagonal_distance = 2.0f * sqrt(2.0f) * scale;
-    
-	if (x > 1 && y > 1)
-		dx += satisfy_constraint(output, lookup(-2, -2), double_diagonal_distance);
-	if (x < (CLOTH_SIZE - 2) && y > 1)
-		dx += satisfy_constraint(output, lookup(+2, -2), double_diagonal_distance);
-	if (x > 1 && y < (CLOTH_SIZE - 2))
-		dx += satisfy_constraint(output, lookup(-2, +2), double_diagonal_distance);
-	if (x < (CLOTH_SIZE - 2) && y < (CLOTH_SIZE - 2))
-		dx += satisfy_constraint(output, lookup(+2, +2), double_diagonal_distance);
-
-	output += dx;
-
 #ifdef ENABLE_SPHERE_COLLISION
     float sphere_radius = SPHERE_RADIUS;
     float4 sphere_position = {0.0f, 0.0f, 0.0f, 1.0f};
@@ -192,39 +108,197 @@ __kernel void constrain(__global float4* unconstrained,
     if (output.z <= PLANE_HEIGHT)
         output.z = PLANE_HEIGHT;
 #endif
-    positions[id] = output;
+    return output;
 }
 
-__kernel void timeStep(__global float4* old_positions,
-                       __global float4* positions)
+// Maps an index in [0, BOUNDARY_NODES) to a node in the outer INTERIOR_MARGIN
+// rows and columns of the grid: first the full rows, then the side columns.
+int2 get_boundary_node(int i)
+{
+    int rows = 2 * INTERIOR_MARGIN * GRID_SIZE;
+    if (i < rows)
+    {
+        int y = i / GRID_SIZE;
+        if (y >= INTERIOR_MARGIN)
+            y += INTERIOR_SIZE;
+        return (int2)(i % GRID_SIZE, y);
+    }
+    
+    i -= rows;
+    int x = i % (2 * INTERIOR_MARGIN);
+    if (x >= INTERIOR_MARGIN)
+        x += INTERIOR_SIZE;
+    return (int2)(x, INTERIOR_MARGIN + i / (2 * INTERIOR_MARGIN));
+}
+
+#define lookup_global(x_offset, y_offset)\
+    unconstrained[(y + y_offset) * (GRID_SIZE) + (x + x_offset)]
+
+#ifdef USE_LOCAL_MEMORY
+
+#define lookup(x_offset, y_offset)\
+    temp[(local_y + y_offset + BORDER) * TEMP_SIZE + (local_x + x_offset + BORDER)]
+
+#else
+
+#define lookup lookup_global
+
+#endif
+
+// Runs over the INTERIOR_SIZE x INTERIOR_SIZE block starting at
+// INTERIOR_MARGIN (passed as the global offset). Every neighbour in the
+// stencil exists there, so no boundary tests are needed.
+__kernel void constrainInterior(__global float4* unconstrained,
+                                __global float4* positions,
+                                __local float4* temp)
 {
     int x = get_global_id(0);
     int y = get_global_id(1);
-    size_t id = y * (CLOTH_SIZE) + x;
+    size_t id = y * (GRID_SIZE) + x;
     
-    if (x < 0 || y < 0 || x >= CLOTH_SIZE || y >= CLOTH_SIZE)
+    const float scale = GRID_SPACING;
+    
+#ifdef USE_LOCAL_MEMORY
+    int local_x = get_local_id(0);
+    int local_y = get_local_id(1);
+    
+    // the tile and its halo are always inside the cloth, so the group
+    // fills it cooperatively row by row
+    int tile_x = x - local_x - BORDER;
+    int tile_y = y - local_y - BORDER;
+    for (int i = local_y * BLOCK_SIZE + local_x; i < TEMP_SIZE * TEMP_SIZE; i += BLOCK_SIZE * BLOCK_SIZE)
+        temp[i] = unconstrained[(tile_y + i / TEMP_SIZE) * GRID_SIZE + (tile_x + i % TEMP_SIZE)];
+    
+    barrier(CLK_LOCAL_MEM_FENCE);
+#endif
+    
+    float4 output = lookup(0, 0);
+    
+    float4 dx = {0.0f, 0.0f, 0.0f, 0.0f};
+    
+    // straight distance constraints: prevents stretching
+    const float straight_distance = 1.0f * scale;
+    dx += satisfy_constraint(output, lookup(-1,  0), straight_distance);
+    dx += satisfy_constraint(output, lookup(+1,  0), straight_distance);
+    dx += satisfy_constraint(output, lookup( 0, +1), straight_distance);
+    dx += satisfy_constraint(output, lookup( 0, -1), straight_distance);
+    
+    // diagonal distance constraints: prevents shearing
+    const float diagonal_distance = sqrt(2.0f) * scale;
+    dx += satisfy_constraint(output, lookup(-1, -1), diagonal_distance);
+    dx += satisfy_constraint(output, lookup(+1, -1), diagonal_distance);
+    dx += satisfy_constraint(output, lookup(-1, +1), diagonal_distance);
+    dx += satisfy_constraint(output, lookup(+1, +1), diagonal_distance);
+    
+    // double diagonal distance constraints: prevents folding
+    const float double_diagonal_distance = 2.0f * sqrt(2.0f) * scale;
+    dx += satisfy_constraint(output, lookup(-2, -2), double_diagonal_distance);
+    dx += satisfy_constraint(output, lookup(+2, -2), double_diagonal_distance);
+    dx += satisfy_constraint(output, lookup(-2, +2), double_diagonal_distance);
+    dx += satisfy_constraint(output, lookup(+2, +2), double_diagonal_distance);
+    
+    positions[id] = collide(output + dx);
+}
+
+// Handles the BOUNDARY_NODES nodes outside the interior block, as a 1D range.
+__kernel void constrainBoundary(__global float4* unconstrained,
+                                __global float4* positions)
+{
+    if (get_global_id(0) >= BOUNDARY_NODES)
         return;
     
-    old_positions[id] = positions[id];
+    int2 node = get_boundary_node(get_global_id(0));
+    int x = node.x;
+    int y = node.y;
+    size_t id = y * (GRID_SIZE) + x;
+    
+    const float scale = GRID_SPACING;
+    
+    float4 output = unconstrained[id];
+
+    float4 dx = {0.0f, 0.0f, 0.0f, 0.0f};
+    
+	// straight distance constraints: prevents stretching
+    
+	const float straight_distance = 1.0f * scale;
+	
+	if (x > 0)
+        dx += satisfy_constraint(output, lookup_global(-1,  0), straight_distance);
+	if (x < (GRID_SIZE - 1))
+		dx += satisfy_constraint(output, lookup_global(+1,  0), straight_distance);
+	if (y < (GRID_SIZE - 1))
+		dx += satisfy_constraint(output, lookup_global( 0, +1), straight_distance);
+	if (y > 0)
+		dx += satisfy_constraint(output, lookup_global( 0, -1), straight_distance);
+    
+	// diagonal distance constraints: prevents shearing
+    
+	const float diagonal_distance = sqrt(2.0f) * scale;
+    
+	if (x > 0 && y > 0)
+		dx += satisfy_constraint(output, lookup_global(-1, -1), diagonal_distance);
+	if (x < (GRID_SIZE - 1) && y > 0)
+		dx += satisfy_constraint(output, lookup_global(+1, -1), diagonal_distance);
+	if (x > 0 && y < (GRID_SIZE - 1))
+		dx += satisfy_constraint(output, lookup_global(-1, +1), diagonal_distance);
+	if (x < (GRID_SIZE - 1) && y < (GRID_SIZE - 1))
+		dx += satisfy_constraint(output, lookup_global(+1, +1), diagonal_distance);
+	
+	// double diagonal distance constraints: prevents folding
+	const float double_diagonal_distance = 2.0f * sqrt(2.0f) * scale;
+    
+	if (x > 1 && y > 1)
+		dx += satisfy_constraint(output, lookup_global(-2, -2), double_diagonal_distance);
+	if (x < (GRID_SIZE - 2) && y > 1)
+		dx += satisfy_constraint(output, lookup_global(+2, -2), double_diagonal_distance);
+	if (x > 1 && y < (GRID_SIZE - 2))
+		dx += satisfy_constraint(output, lookup_global(-2, +2), double_diagonal_distance);
+	if (x < (GRID_SIZE - 2) && y < (GRID_SIZE - 2))
+		dx += satisfy_constraint(output, lookup_global(+2, +2), double_diagonal_distance);
+
+    positions[id] = collide(output + dx);
 }
 
 float4 get_clamped_node(__global float4* positions, int x, int y)
 {
-    x = max(0, min(CLOTH_SIZE - 1, x));
-    y = max(0, min(CLOTH_SIZE - 1, y));
-    size_t id = y * CLOTH_SIZE + x;
+    x = max(0, min(GRID_SIZE - 1, x));
+    y = max(0, min(GRID_SIZE - 1, y));
+    size_t id = y * GRID_SIZE + x;
     return positions[id];
 }
 
-__kernel void calculateNormals(__global float4* positions,
-                               __global float4* normals)
+// Same interior block as constrainInterior; all four neighbours exist.
+__kernel void calculateNormalsInterior(__global float4* positions,
+                                       __global float4* normals)
 {
     int x = get_global_id(0);
     int y = get_global_id(1);
-    size_t id = y * (CLOTH_SIZE) + x;
+    size_t id = y * (GRID_SIZE) + x;
     
-    if (x < 0 || y < 0 || x >= CLOTH_SIZE || y >= CLOTH_SIZE)
+    float4 output = positions[id];
+    float4 right = positions[id + 1];
+    float4 left = positions[id - 1];
+    float4 down = positions[id + GRID_SIZE];
+    float4 up = positions[id - GRID_SIZE];
+    
+    float4 sum = cross(left - output, up - output);
+    sum += cross(down - output, left - output);
+    sum += cross(right - output, down - output);
+    sum += cross(up - output, right - output);
+    
+    normals[id] = sum / fast_length(sum);
+}
+
+__kernel void calculateNormalsBoundary(__global float4* positions,
+                                       __global float4* normals)
+{
+    if (get_global_id(0) >= BOUNDARY_NODES)
         return;
+    
+    int2 node = get_boundary_node(get_global_id(0));
+    int x = node.x;
+    int y = node.y;
+    size_t id = y * (GRID_SIZE) + x;
 
 	float4 output = positions[id];
 	float4 right = get_clamped_node(positions, x + 1, y);
@@ -236,12 +310,374 @@ __kernel void calculateNormals(__global float4* positions,
 
     if (x > 0 && y > 0)
         sum += cross(left - output, up - output);
-    if (x > 0 && y < (CLOTH_SIZE - 1))
+    if (x > 0 && y < (GRID_SIZE - 1))
         sum += cross(down - output, left - output);
-    if (x < (CLOTH_SIZE - 1) && y > (CLOTH_SIZE - 1))
+    if (x < (GRID_SIZE - 1) && y < (GRID_SIZE - 1))
         sum += cross(right - output, down - output);
-    if (x < (CLOTH_SIZE - 1) && y < (CLOTH_SIZE - 1))
+    if (x < (GRID_SIZE - 1) && y > 0)
         sum += cross(up - output, right - output);
     
     normals[id] = sum / fast_length(sum);
 }
+
+float4 catmull_rom(float4 p0, float4 p1, float4 p2, float4 p3, float t)
+{
+    return p1 + 0.5f * t * (p2 - p0 + t * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3 + t * (3.0f * (p1 - p2) + p3 - p0)));
+}
+
+// Position of a full resolution node on the simulated grid, which is
+// stretched to cover the same cloth. Returns the cell in xy and the
+// interpolation weights in zw.
+float4 get_refined_cell(int x, int y)
+{
+    float grid_x = x * (GRID_SIZE - 1.0f) / (CLOTH_SIZE - 1);
+    float grid_y = y * (GRID_SIZE - 1.0f) / (CLOTH_SIZE - 1);
+    float cell_x = min(floor(grid_x), GRID_SIZE - 2.0f);
+    float cell_y = min(floor(grid_y), GRID_SIZE - 2.0f);
+    return (float4)(cell_x, cell_y, grid_x - cell_x, grid_y - cell_y);
+}
+
+// Catmull-Rom interpolation of a 4x4 patch of nodes around a cell, row by
+// row and then down the column. Past the edges of the grid the patch holds
+// clamped nodes, which are replaced by linear extrapolation so that straight
+// edges stay straight.
+float4 interpolate_patch(float4* patch, float4 cell)
+{
+    for (int i = 0; i != 4; ++i)
+    {
+        if (cell.x == 0.0f)
+            patch[i * 4] = 2.0f * patch[i * 4 + 1] - patch[i * 4 + 2];
+        if (cell.x == GRID_SIZE - 2.0f)
+            patch[i * 4 + 3] = 2.0f * patch[i * 4 + 2] - patch[i * 4 + 1];
+    }
+    for (int i = 0; i != 4; ++i)
+    {
+        if (cell.y == 0.0f)
+            patch[i] = 2.0f * patch[4 + i] - patch[8 + i];
+        if (cell.y == GRID_SIZE - 2.0f)
+            patch[12 + i] = 2.0f * patch[8 + i] - patch[4 + i];
+    }
+    
+    float4 rows[4];
+    for (int i = 0; i != 4; ++i)
+        rows[i] = catmull_rom(patch[i * 4], patch[i * 4 + 1], patch[i * 4 + 2], patch[i * 4 + 3], cell.z);
+    return catmull_rom(rows[0], rows[1], rows[2], rows[3], cell.w);
+}
+
+// Bicubic upsampling of the simulated grid to the CLOTH_SIZE vertices handed
+// to the renderer. Runs over CLOTH_SIZE x CLOTH_SIZE.
+__kernel void refine(__global float4* positions,
+                     __global float4* vertices)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    size_t id = y * CLOTH_SIZE + x;
+    
+    if (x >= CLOTH_SIZE || y >= CLOTH_SIZE)
+        return;
+    
+    float4 cell = get_refined_cell(x, y);
+    int cell_x = (int)cell.x;
+    int cell_y = (int)cell.y;
+    
+    float4 patch[16];
+    for (int i = 0; i != 16; ++i)
+        patch[i] = get_clamped_node(positions, cell_x - 1 + i % 4, cell_y - 1 + i / 4);
+    vertices[id] = interpolate_patch(patch, cell);
+}
+
+// Row kernels, used on CPU devices. Each work-item handles ROW_VECTOR_WIDTH
+// consecutive nodes of one row as wide vectors. The x, y and z coordinates
+// are stored as three planes of ROW_PLANE_SIZE floats, padded so that every
+// neighbour run in the stencil can be loaded whole. Lanes whose neighbour is
+// outside the cloth are masked out rather than branched around.
+
+#define ROW_CONCAT_(a, b) a##b
+#define ROW_CONCAT(a, b) ROW_CONCAT_(a, b)
+#define floatn ROW_CONCAT(float, ROW_VECTOR_WIDTH)
+#define intn ROW_CONCAT(int, ROW_VECTOR_WIDTH)
+#define vloadn ROW_CONCAT(vload, ROW_VECTOR_WIDTH)
+#define vstoren ROW_CONCAT(vstore, ROW_VECTOR_WIDTH)
+
+#define row_index(x, y) (((y) + BORDER) * ROW_PITCH + ROW_VECTOR_WIDTH + (x))
+#define row_mask(condition) ((intn)((condition) ? -1 : 0))
+
+#define load_row(plane, x_offset, y_offset)\
+    vloadn(0, plane + id + (y_offset) * ROW_PITCH + (x_offset))
+
+__constant int row_lanes[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+void satisfy_constraint_row(floatn x, floatn y, floatn z,
+                            floatn other_x, floatn other_y, floatn other_z,
+                            float rest_distance, intn mask,
+                            floatn* dx, floatn* dy, floatn* dz)
+{
+    float stiffness = SOLVER_STIFFNESS;
+    
+    floatn delta_x = other_x - x;
+    floatn delta_y = other_y - y;
+    floatn delta_z = other_z - z;
+    floatn delta_length = sqrt(delta_x * delta_x + delta_y * delta_y + delta_z * delta_z);
+    floatn difference = (delta_length - rest_distance) / delta_length;
+    *dx += select((floatn)(0.0f), delta_x * stiffness * difference, mask);
+    *dy += select((floatn)(0.0f), delta_y * stiffness * difference, mask);
+    *dz += select((floatn)(0.0f), delta_z * stiffness * difference, mask);
+}
+
+void collide_row(floatn* x, floatn* y, floatn* z)
+{
+#ifdef ENABLE_SPHERE_COLLISION
+    float sphere_radius = SPHERE_RADIUS;
+    
+    // the sphere is at the origin, so the delta is -position
+    floatn delta_length = sqrt(*x * *x + *y * *y + *z * *z);
+    floatn difference = (delta_length - sphere_radius) / delta_length;
+    intn inside = delta_length < sphere_radius;
+    *x += select((floatn)(0.0f), -*x * difference, inside);
+    *y += select((floatn)(0.0f), -*y * difference, inside);
+    *z += select((floatn)(0.0f), -*z * difference, inside);
+#endif
+    
+#ifdef ENABLE_CYLINDER_COLLISION
+    float radius = CYLINDER_RADIUS;
+    float table_height = CYLINDER_HEIGHT;
+    float table_width = CYLINDER_THICKNESS;
+    
+    // matches the float4 kernels, where flat keeps w = 1
+    floatn flat_length = sqrt(*x * *x + *y * *y + 1.0f);
+    intn inside = (flat_length < radius) & (fabs(*z - table_height) < table_width * 0.5f);
+    
+    floatn top_distance = table_height + table_width * 0.5f - *z;
+    floatn bottom_distance = *z - (table_height - table_width * 0.5f);
+    floatn xy_distance = radius - flat_length;
+    intn top = inside & (top_distance < xy_distance) & (top_distance < bottom_distance);
+    intn bottom = inside & ~top & (bottom_distance < xy_distance);
+    intn side = inside & ~top & ~bottom;
+    
+    *z = select(*z, (floatn)(table_height + table_width * 0.5f), top);
+    *z = select(*z, (floatn)(table_height - table_width * 0.5f), bottom);
+    *x = select(*x, radius * *x / flat_length, side);
+    *y = select(*y, radius * *y / flat_length, side);
+#endif
+    
+#ifdef ENABLE_CUBE_COLLISION
+    floatn x_distance = fabs(*x) - CUBE_SIZE;
+    floatn y_distance = fabs(*y) - CUBE_SIZE;
+    floatn z_distance = fabs(*z) - CUBE_SIZE;
+    intn inside = (x_distance < 0.0f) & (y_distance < 0.0f) & (z_distance < 0.0f);
+    intn along_x = inside & (x_distance > y_distance) & (x_distance > z_distance);
+    intn along_y = inside & ~along_x & (y_distance > z_distance);
+    intn along_z = inside & ~along_x & ~along_y;
+    
+    *x = select(*x, select((floatn)(-CUBE_SIZE), (floatn)(CUBE_SIZE), *x > 0.0f), along_x);
+    *y = select(*y, select((floatn)(-CUBE_SIZE), (floatn)(CUBE_SIZE), *y > 0.0f), along_y);
+    *z = select(*z, select((floatn)(-CUBE_SIZE), (floatn)(CUBE_SIZE), *z > 0.0f), along_z);
+#endif
+    
+#ifdef ENABLE_PLANE_COLLISION
+    *z = select(*z, (floatn)(PLANE_HEIGHT), *z <= PLANE_HEIGHT);
+#endif
+}
+
+__kernel void advanceRows(__global float* old_positions,
+                          __global float* positions,
+                          __global float* unconstrained)
+{
+    int x = get_global_id(0) * ROW_VECTOR_WIDTH;
+    int y = get_global_id(1);
+    size_t id = row_index(x, y);
+    
+    if (x >= GRID_SIZE || y >= GRID_SIZE)
+        return;
+    
+    float timestep = SOLVER_TIMESTEP;
+    float damping = SOLVER_DAMPING;
+    for (int plane = 0; plane != 3; ++plane)
+    {
+        size_t i = id + plane * ROW_PLANE_SIZE;
+        float acc = plane == 2 ? SOLVER_GRAVITY * timestep * timestep : 0.0f;
+        floatn vel = (2.0f - damping) * vloadn(0, positions + i) - (1.0f - damping) * vloadn(0, old_positions + i);
+        vstoren(vel + acc, 0, unconstrained + i);
+    }
+}
+
+#define constrain_row(x_offset, y_offset, distance, mask)\
+    satisfy_constraint_row(output_x, output_y, output_z,\
+                           load_row(unconstrained_x, x_offset, y_offset),\
+                           load_row(unconstrained_y, x_offset, y_offset),\
+                           load_row(unconstrained_z, x_offset, y_offset),\
+                           distance, mask, &dx, &dy, &dz)
+
+__kernel void constrainRows(__global float* unconstrained,
+                            __global float* positions)
+{
+    int x = get_global_id(0) * ROW_VECTOR_WIDTH;
+    int y = get_global_id(1);
+    size_t id = row_index(x, y);
+    
+    if (x >= GRID_SIZE || y >= GRID_SIZE)
+        return;
+    
+    const float scale = GRID_SPACING;
+    
+    __global float* unconstrained_x = unconstrained;
+    __global float* unconstrained_y = unconstrained + ROW_PLANE_SIZE;
+    __global float* unconstrained_z = unconstrained + 2 * ROW_PLANE_SIZE;
+    
+    floatn output_x = load_row(unconstrained_x, 0, 0);
+    floatn output_y = load_row(unconstrained_y, 0, 0);
+    floatn output_z = load_row(unconstrained_z, 0, 0);
+    
+    floatn dx = 0.0f;
+    floatn dy = 0.0f;
+    floatn dz = 0.0f;
+    
+    intn lanes = x + vloadn(0, row_lanes);
+    intn left_1 = lanes > 0;
+    intn left_2 = lanes > 1;
+    intn right_1 = lanes < (GRID_SIZE - 1);
+    intn right_2 = lanes < (GRID_SIZE - 2);
+    intn up_1 = row_mask(y > 0);
+    intn up_2 = row_mask(y > 1);
+    intn down_1 = row_mask(y < (GRID_SIZE - 1));
+    intn down_2 = row_mask(y < (GRID_SIZE - 2));
+    
+    // straight distance constraints: prevents stretching
+    const float straight_distance = 1.0f * scale;
+    constrain_row(-1,  0, straight_distance, left_1);
+    constrain_row(+1,  0, straight_distance, right_1);
+    constrain_row( 0, +1, straight_distance, down_1);
+    constrain_row( 0, -1, straight_distance, up_1);
+    
+    // diagonal distance constraints: prevents shearing
+    const float diagonal_distance = sqrt(2.0f) * scale;
+    constrain_row(-1, -1, diagonal_distance, left_1 & up_1);
+    constrain_row(+1, -1, diagonal_distance, right_1 & up_1);
+    constrain_row(-1, +1, diagonal_distance, left_1 & down_1);
+    constrain_row(+1, +1, diagonal_distance, right_1 & down_1);
+    
+    // double diagonal distance constraints: prevents folding
+    const float double_diagonal_distance = 2.0f * sqrt(2.0f) * scale;
+    constrain_row(-2, -2, double_diagonal_distance, left_2 & up_2);
+    constrain_row(+2, -2, double_diagonal_distance, right_2 & up_2);
+    constrain_row(-2, +2, double_diagonal_distance, left_2 & down_2);
+    constrain_row(+2, +2, double_diagonal_distance, right_2 & down_2);
+    
+    output_x += dx;
+    output_y += dy;
+    output_z += dz;
+    collide_row(&output_x, &output_y, &output_z);
+    
+    vstoren(output_x, 0, positions + id);
+    vstoren(output_y, 0, positions + id + ROW_PLANE_SIZE);
+    vstoren(output_z, 0, positions + id + 2 * ROW_PLANE_SIZE);
+}
+
+void cross_row(floatn a_x, floatn a_y, floatn a_z,
+               floatn b_x, floatn b_y, floatn b_z, intn mask,
+               floatn* sum_x, floatn* sum_y, floatn* sum_z)
+{
+    *sum_x += select((floatn)(0.0f), a_y * b_z - a_z * b_y, mask);
+    *sum_y += select((floatn)(0.0f), a_z * b_x - a_x * b_z, mask);
+    *sum_z += select((floatn)(0.0f), a_x * b_y - a_y * b_x, mask);
+}
+
+// Also writes the positions out as float4 vertices for the renderer.
+__kernel void calculateNormalsRows(__global float* positions,
+                                   __global float4* normals,
+                                   __global float4* vertices)
+{
+    int x = get_global_id(0) * ROW_VECTOR_WIDTH;
+    int y = get_global_id(1);
+    size_t id = row_index(x, y);
+    
+    if (x >= GRID_SIZE || y >= GRID_SIZE)
+        return;
+    
+    __global float* positions_x = positions;
+    __global float* positions_y = positions + ROW_PLANE_SIZE;
+    __global float* positions_z = positions + 2 * ROW_PLANE_SIZE;
+    
+    floatn output_x = load_row(positions_x, 0, 0);
+    floatn output_y = load_row(positions_y, 0, 0);
+    floatn output_z = load_row(positions_z, 0, 0);
+    
+    floatn right_x = load_row(positions_x, +1, 0) - output_x;
+    floatn right_y = load_row(positions_y, +1, 0) - output_y;
+    floatn right_z = load_row(positions_z, +1, 0) - output_z;
+    floatn left_x = load_row(positions_x, -1, 0) - output_x;
+    floatn left_y = load_row(positions_y, -1, 0) - output_y;
+    floatn left_z = load_row(positions_z, -1, 0) - output_z;
+    floatn down_x = load_row(positions_x, 0, +1) - output_x;
+    floatn down_y = load_row(positions_y, 0, +1) - output_y;
+    floatn down_z = load_row(positions_z, 0, +1) - output_z;
+    floatn up_x = load_row(positions_x, 0, -1) - output_x;
+    floatn up_y = load_row(positions_y, 0, -1) - output_y;
+    floatn up_z = load_row(positions_z, 0, -1) - output_z;
+    
+    intn lanes = x + vloadn(0, row_lanes);
+    intn left = lanes > 0;
+    intn right = lanes < (GRID_SIZE - 1);
+    intn up = row_mask(y > 0);
+    intn down = row_mask(y < (GRID_SIZE - 1));
+    
+    floatn sum_x = 0.0f;
+    floatn sum_y = 0.0f;
+    floatn sum_z = 0.0f;
+    cross_row(left_x, left_y, left_z, up_x, up_y, up_z, left & up, &sum_x, &sum_y, &sum_z);
+    cross_row(down_x, down_y, down_z, left_x, left_y, left_z, left & down, &sum_x, &sum_y, &sum_z);
+    cross_row(right_x, right_y, right_z, down_x, down_y, down_z, right & down, &sum_x, &sum_y, &sum_z);
+    cross_row(up_x, up_y, up_z, right_x, right_y, right_z, right & up, &sum_x, &sum_y, &sum_z);
+    
+    floatn sum_length = sqrt(sum_x * sum_x + sum_y * sum_y + sum_z * sum_z);
+    
+    float node_x[ROW_VECTOR_WIDTH];
+    float node_y[ROW_VECTOR_WIDTH];
+    float node_z[ROW_VECTOR_WIDTH];
+    float normal_x[ROW_VECTOR_WIDTH];
+    float normal_y[ROW_VECTOR_WIDTH];
+    float normal_z[ROW_VECTOR_WIDTH];
+    vstoren(output_x, 0, node_x);
+    vstoren(output_y, 0, node_y);
+    vstoren(output_z, 0, node_z);
+    vstoren(sum_x / sum_length, 0, normal_x);
+    vstoren(sum_y / sum_length, 0, normal_y);
+    vstoren(sum_z / sum_length, 0, normal_z);
+    
+    for (int i = 0; i != ROW_VECTOR_WIDTH; ++i)
+    {
+        size_t node = y * GRID_SIZE + x + i;
+        vertices[node] = (float4)(node_x[i], node_y[i], node_z[i], 1.0f);
+        normals[node] = (float4)(normal_x[i], normal_y[i], normal_z[i], 0.0f);
+    }
+}
+
+float4 get_clamped_row_node(__global float* positions, int x, int y)
+{
+    x = max(0, min(GRID_SIZE - 1, x));
+    y = max(0, min(GRID_SIZE - 1, y));
+    size_t id = row_index(x, y);
+    return (float4)(positions[id], positions[id + ROW_PLANE_SIZE], positions[id + 2 * ROW_PLANE_SIZE], 1.0f);
+}
+
+// Same as refine, reading the planes of the row kernels.
+__kernel void refineRows(__global float* positions,
+                         __global float4* vertices)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    size_t id = y * CLOTH_SIZE + x;
+    
+    if (x >= CLOTH_SIZE || y >= CLOTH_SIZE)
+        return;
+    
+    float4 cell = get_refined_cell(x, y);
+    int cell_x = (int)cell.x;
+    int cell_y = (int)cell.y;
+    
+    float4 patch[16];
+    for (int i = 0; i != 16; ++i)
+        patch[i] = get_clamped_row_node(positions, cell_x - 1 + i % 4, cell_y - 1 + i / 4);
+    vertices[id] = interpolate_patch(patch, cell);
+}
+
@@ -5,6 +5,7 @@
 #include <cmath>
 #include <string>
 #include <sstream>
+#include <algorithm>
 
 #ifdef __APPLE__
 #include <OpenCL/opencl.h>
@@ -27,6 +28,18 @@
 
 class Cloth;
 
+// The kernels built for one simulation level (see SIMULATION_LEVEL).
+struct ClothKernels
+{
+    cl_program program;
+    cl_kernel advanceKernel;
+    cl_kernel constrainKernel;
+    cl_kernel constrainBoundaryKernel;
+    cl_kernel normalsKernel;
+    cl_kernel normalsBoundaryKernel;
+    cl_kernel refineKernel;
+};
+
 class ClothSim
 {
 public:
@@ -40,29 +53,24 @@ public:
 private:
     void uninit();
     
-    cl_program build(const std::string& filename) const;
+    cl_program build(const std::string& filename, int level) const;
     std::string readLines(const std::string& filename) const;
     
     cl_context context;
     std::vector<cl_device_id> devices;
-    cl_program program;
     cl_command_queue commandQueue;
-    cl_kernel advanceKernel;
-    cl_kernel constrainEvenKernel;
-    cl_kernel constrainOddKernel;
-    cl_kernel stepKernel;
-    cl_kernel normalsKernel;
+    std::vector<ClothKernels> levels;
+    cl_kernel displayNormalsKernel;
+    cl_kernel displayNormalsBoundaryKernel;
+    bool rowKernels;
 };
 
 ClothSim::ClothSim()
     : context(0)
-    , program(0)
     , commandQueue(0)
-    , advanceKernel(0)
-    , constrainEvenKernel(0)
-    , constrainOddKernel(0)
-    , stepKernel(0)
-    , normalsKernel(0)
+    , displayNormalsKernel(0)
+    , displayNormalsBoundaryKernel(0)
+    , rowKernels(false)
 {
 }
 
@@ -92,28 +100,63 @@ void ClothSim::init()
     
     commandQueue = clCreateCommandQueue(context, devices[0], NULL, &error);
     
-    program = build("kernel.cl");
+    // CPU devices get the row kernels, which vectorize along the rows
+    cl_device_type deviceType = 0;
+    error = clGetDeviceInfo(devices[0], CL_DEVICE_TYPE, sizeof(deviceType), &deviceType, NULL);
+    assert(!error);
+    rowKernels = (deviceType & CL_DEVICE_TYPE_CPU) != 0;
     
-    advanceKernel = clCreateKernel(program, "advance", &error);
-    constrainEvenKernel = clCreateKernel(program, "constrain", &error);
-    constrainOddKernel = clCreateKernel(program, "constrain", &error);
-    stepKernel = clCreateKernel(program, "timeStep", &error);
-    normalsKernel = clCreateKernel(program, "calculateNormals", &error);
+    levels.resize(SIMULATION_LEVELS);
+    for (int level = 0; level != SIMULATION_LEVELS; ++level)
+    {
+        ClothKernels& kernels = levels[level];
+        kernels.program = build("kernel.cl", level);
+        
+        if (rowKernels)
+        {
+            kernels.advanceKernel = clCreateKernel(kernels.program, "advanceRows", &error);
+            kernels.constrainKernel = clCreateKernel(kernels.program, "constrainRows", &error);
+            kernels.normalsKernel = clCreateKernel(kernels.program, "calculateNormalsRows", &error);
+            kernels.refineKernel = clCreateKernel(kernels.program, "refineRows", &error);
+        }
+        else
+        {
+            kernels.advanceKernel = clCreateKernel(kernels.program, "advance", &error);
+            kernels.constrainKernel = clCreateKernel(kernels.program, "constrainInterior", &error);
+            kernels.constrainBoundaryKernel = clCreateKernel(kernels.program, "constrainBoundary", &error);
+            kernels.normalsKernel = clCreateKernel(kernels.program, "calculateNormalsInterior", &error);
+            kernels.normalsBoundaryKernel = clCreateKernel(kernels.program, "calculateNormalsBoundary", &error);
+            kernels.refineKernel = clCreateKernel(kernels.program, "refine", &error);
+        }
+    }
+    
+    // the refined vertices are always float4, whatever the device
+    displayNormalsKernel = clCreateKernel(levels[0].program, "calculateNormalsInterior", &error);
+    displayNormalsBoundaryKernel = clCreateKernel(levels[0].program, "calculateNormalsBoundary", &error);
 }
 
 void ClothSim::uninit()
 {
-    clReleaseKernel(normalsKernel);
-    clReleaseKernel(stepKernel);
-    clReleaseKernel(constrainOddKernel);
-    clReleaseKernel(constrainEvenKernel);
-    clReleaseKernel(advanceKernel);
+    clReleaseKernel(displayNormalsBoundaryKernel);
+    clReleaseKernel(displayNormalsKernel);
+    for (std::size_t i = 0; i != levels.size(); ++i)
+    {
+        ClothKernels& kernels = levels[i];
+        clReleaseKernel(kernels.refineKernel);
+        if (kernels.normalsBoundaryKernel)
+            clReleaseKernel(kernels.normalsBoundaryKernel);
+        clReleaseKernel(kernels.normalsKernel);
+        if (kernels.constrainBoundaryKernel)
+            clReleaseKernel(kernels.constrainBoundaryKernel);
+        clReleaseKernel(kernels.constrainKernel);
+        clReleaseKernel(kernels.advanceKernel);
+        clReleaseProgram(kernels.program);
+    }
     clReleaseCommandQueue(commandQueue);
-    clReleaseProgram(program);
     clReleaseContext(context);
 }
 
-cl_program ClothSim::build(const std::string& filename) const
+cl_program ClothSim::build(const std::string& filename, int level) const
 {
     cl_program program;
     
@@ -124,8 +167,10 @@ cl_program ClothSim::build(const std::string& filename) const
     const char* start = &lines[0];
     program = clCreateProgramWithSource(context, 1, (const char**)&start, (const size_t*)&size, &error);
     
-    const char *options = "-cl-denorms-are-zero -cl-strict-aliasing -cl-fast-relaxed-math -cl-mad-enable -cl-no-signed-zeros";
-    error = clBuildProgram(program, 1, &devices[0], options, NULL, NULL);
+    std::ostringstream options;
+    options << "-cl-denorms-are-zero -cl-strict-aliasing -cl-fast-relaxed-math -cl-mad-enable -cl-no-signed-zeros";
+    options << " -D SIMULATION_LEVEL=" << level;
+    error = clBuildProgram(program, 1, &devices[0], options.str().c_str(), NULL, NULL);
     assert(!error);
     
     return program;
@@ -150,13 +195,30 @@ public:
     void step();
     void transfer();
     
+    void setLevel(int level);
+    int getLevel() const { return level; }
+    
     cl_float4* getVertices() { return &result[0]; }
     cl_float4* getNormals() { return &normalsResult[0]; }
     
 private:
     void uninit();
     
+    void createPositions(const std::vector<cl_float4>& oldNodes, const std::vector<cl_float4>& nodes);
+    void releasePositions();
+    std::vector<cl_float4> readPositions(cl_mem buffer);
+    std::vector<cl_float4> restrictToGrid(const std::vector<cl_float4>& nodes) const;
+    std::vector<cl_float> toRows(const std::vector<cl_float4>& nodes) const;
+    std::vector<cl_float4> fromRows(const std::vector<cl_float>& rows) const;
+    size_t gridSize() const { return GRID_SIZE_AT(level); }
+    
+    void refine(cl_mem buffer);
+    void setBuffer(cl_kernel kernel, cl_uint index, cl_mem buffer);
+    void enqueueNodes(cl_kernel kernel, size_t size);
+    void enqueueStencil(cl_kernel kernel, cl_kernel boundaryKernel, size_t size);
+    
     ClothSim& sim;
+    int level;
     
     std::vector<cl_float4> result;
     std::vector<cl_float4> normalsResult;
@@ -164,10 +226,12 @@ private:
     cl_mem positions;
     cl_mem newPositions;
     cl_mem normals;
+    cl_mem vertices;
 };
 
 Cloth::Cloth(ClothSim& sim)
     : sim(sim)
+    , level(0)
 {
 }
 
@@ -197,78 +261,284 @@ void Cloth::init()
         result[i].s[3] = 1.0f;
     }
     
+    std::vector<cl_float4> nodes = restrictToGrid(result);
+    createPositions(nodes, nodes);
+    
     cl_int error = 0;
     size_t verticesSize = size * size * sizeof(cl_float4);
-    oldPositions = clCreateBuffer(sim.context, CL_MEM_COPY_HOST_PTR, verticesSize, &result[0], &error);
-    assert(!error);
-    positions = clCreateBuffer(sim.context, CL_MEM_COPY_HOST_PTR, verticesSize, &result[0], &error);
-    assert(!error);
-    newPositions = clCreateBuffer(sim.context, CL_MEM_WRITE_ONLY, verticesSize, NULL, &error);
-    assert(!error);
     normals = clCreateBuffer(sim.context, CL_MEM_WRITE_ONLY, verticesSize, NULL, &error);
     assert(!error);
-    
-    error = clSetKernelArg(sim.advanceKernel, 0, sizeof(cl_mem), &oldPositions);
-    assert(!error);
-    error = clSetKernelArg(sim.advanceKernel, 1, sizeof(cl_mem), &positions);
-    assert(!error);
-    error = clSetKernelArg(sim.advanceKernel, 2, sizeof(cl_mem), &newPositions);
-    assert(!error);
-    
-    error = clSetKernelArg(sim.constrainEvenKernel, 0, sizeof(cl_mem), &newPositions);
-    assert(!error);
-    error = clSetKernelArg(sim.constrainEvenKernel, 1, sizeof(cl_mem), &positions);
-    assert(!error);
-    error = clSetKernelArg(sim.constrainEvenKernel, 2, sizeof(cl_float4) * TEMP_SIZE * TEMP_SIZE, NULL);
-    assert(!error);
-    
-    error = clSetKernelArg(sim.constrainOddKernel, 0, sizeof(cl_mem), &positions);
-    assert(!error);
-    error = clSetKernelArg(sim.constrainOddKernel, 1, sizeof(cl_mem), &newPositions);
-    assert(!error);
-    error = clSetKernelArg(sim.constrainOddKernel, 2, sizeof(cl_float4) * TEMP_SIZE * TEMP_SIZE, NULL);
+    vertices = clCreateBuffer(sim.context, CL_MEM_READ_WRITE, verticesSize, NULL, &error);
     assert(!error);
     
-    error = clSetKernelArg(sim.stepKernel, 0, sizeof(cl_mem), &oldPositions);
-    assert(!error);
-    error = clSetKernelArg(sim.stepKernel, 1, sizeof(cl_mem), &positions);
-    assert(!error);
-    
-    error = clSetKernelArg(sim.normalsKernel, 0, sizeof(cl_mem), &positions);
-    assert(!error);
-    error = clSetKernelArg(sim.normalsKernel, 1, sizeof(cl_mem), &normals);
-    assert(!error);
+    // the position buffers rotate every step, so they are bound in step()
+    for (std::size_t i = 0; i != sim.levels.size(); ++i)
+    {
+        ClothKernels& kernels = sim.levels[i];
+        setBuffer(kernels.normalsKernel, 1, normals);
+        setBuffer(kernels.normalsBoundaryKernel, 1, normals);
+        setBuffer(kernels.refineKernel, 1, vertices);
+        
+        if (sim.rowKernels)
+        {
+            setBuffer(kernels.normalsKernel, 2, vertices);
+        }
+        else
+        {
+            error = clSetKernelArg(kernels.constrainKernel, 2, sizeof(cl_float4) * TEMP_SIZE * TEMP_SIZE, NULL);
+            assert(!error);
+        }
+    }
+    setBuffer(sim.displayNormalsKernel, 0, vertices);
+    setBuffer(sim.displayNormalsKernel, 1, normals);
+    setBuffer(sim.displayNormalsBoundaryKernel, 0, vertices);
+    setBuffer(sim.displayNormalsBoundaryKernel, 1, normals);
 }
 
 void Cloth::uninit()
 {
     result.clear();
+    releasePositions();
+    clReleaseMemObject(normals);
+    clReleaseMemObject(vertices);
+}
+
+void Cloth::setLevel(int newLevel)
+{
+    if (newLevel == level)
+        return;
+    
+    // prolongate the state to full resolution, then restrict it to the new grid
+    std::vector<cl_float4> oldNodes = readPositions(oldPositions);
+    std::vector<cl_float4> nodes = readPositions(positions);
+    releasePositions();
+    level = newLevel;
+    createPositions(restrictToGrid(oldNodes), restrictToGrid(nodes));
+}
+
+void Cloth::createPositions(const std::vector<cl_float4>& oldNodes, const std::vector<cl_float4>& nodes)
+{
+    cl_int error = 0;
+    if (sim.rowKernels)
+    {
+        std::vector<cl_float> oldRows = toRows(oldNodes);
+        std::vector<cl_float> rows = toRows(nodes);
+        size_t rowsSize = rows.size() * sizeof(cl_float);
+        oldPositions = clCreateBuffer(sim.context, CL_MEM_COPY_HOST_PTR, rowsSize, &oldRows[0], &error);
+        assert(!error);
+        positions = clCreateBuffer(sim.context, CL_MEM_COPY_HOST_PTR, rowsSize, &rows[0], &error);
+        assert(!error);
+        newPositions = clCreateBuffer(sim.context, CL_MEM_COPY_HOST_PTR, rowsSize, &rows[0], &error);
+        assert(!error);
+    }
+    else
+    {
+        size_t positionsSize = nodes.size() * sizeof(cl_float4);
+        oldPositions = clCreateBuffer(sim.context, CL_MEM_COPY_HOST_PTR, positionsSize, (void*)&oldNodes[0], &error);
+        assert(!error);
+        positions = clCreateBuffer(sim.context, CL_MEM_COPY_HOST_PTR, positionsSize, (void*)&nodes[0], &error);
+        assert(!error);
+        newPositions = clCreateBuffer(sim.context, CL_MEM_READ_WRITE, positionsSize, NULL, &error);
+        assert(!error);
+    }
+}
+
+void Cloth::releasePositions()
+{
     clReleaseMemObject(oldPositions);
     clReleaseMemObject(positions);
     clReleaseMemObject(newPositions);
-    clReleaseMemObject(normals);
 }
 
-void Cloth::step()
+std::vector<cl_float4> Cloth::readPositions(cl_mem buffer)
 {
     cl_int error = 0;
+    std::vector<cl_float4> nodes(CLOTH_SIZE * CLOTH_SIZE);
+    size_t nodesSize = nodes.size() * sizeof(cl_float4);
+    if (level > 0)
+    {
+        // prolongate with the same refinement that is used for display
+        refine(buffer);
+        error = clEnqueueReadBuffer(sim.commandQueue, vertices, CL_TRUE, 0, nodesSize, (void*)&nodes[0], 0, NULL, NULL);
+        assert(!error);
+    }
+    else if (sim.rowKernels)
+    {
+        std::vector<cl_float> rows(3 * ROW_PLANE_SIZE_AT(CLOTH_SIZE));
+        error = clEnqueueReadBuffer(sim.commandQueue, buffer, CL_TRUE, 0, rows.size() * sizeof(cl_float), (void*)&rows[0], 0, NULL, NULL);
+        assert(!error);
+        nodes = fromRows(rows);
+    }
+    else
+    {
+        error = clEnqueueReadBuffer(sim.commandQueue, buffer, CL_TRUE, 0, nodesSize, (void*)&nodes[0], 0, NULL, NULL);
+        assert(!error);
+    }
+    return nodes;
+}
+
+std::vector<cl_float4> Cloth::restrictToGrid(const std::vector<cl_float4>& nodes) const
+{
+    // bilinear samples of the full resolution nodes at the simulated grid,
+    // which covers the same cloth with fewer nodes
+    size_t size = gridSize();
+    std::vector<cl_float4> grid(size * size);
+    for (std::size_t i = 0; i != grid.size(); ++i)
+    {
+        float x = float(i % size) * (CLOTH_SIZE - 1) / (size - 1);
+        float y = float(i / size) * (CLOTH_SIZE - 1) / (size - 1);
+        std::size_t cellX = std::min(std::size_t(x), std::size_t(CLOTH_SIZE - 2));
+        std::size_t cellY = std::min(std::size_t(y), std::size_t(CLOTH_SIZE - 2));
+        float tx = x - cellX;
+        float ty = y - cellY;
+        
+        const cl_float4& topLeft = nodes[cellY * CLOTH_SIZE + cellX];
+        const cl_float4& topRight = nodes[cellY * CLOTH_SIZE + cellX + 1];
+        const cl_float4& bottomLeft = nodes[(cellY + 1) * CLOTH_SIZE + cellX];
+        const cl_float4& bottomRight = nodes[(cellY + 1) * CLOTH_SIZE + cellX + 1];
+        for (int k = 0; k != 3; ++k)
+        {
+            float top = (1.0f - tx) * topLeft.s[k] + tx * topRight.s[k];
+            float bottom = (1.0f - tx) * bottomLeft.s[k] + tx * bottomRight.s[k];
+            grid[i].s[k] = (1.0f - ty) * top + ty * bottom;
+        }
+        grid[i].s[3] = 1.0f;
+    }
+    return grid;
+}
+
+std::vector<cl_float> Cloth::toRows(const std::vector<cl_float4>& nodes) const
+{
+    // x, y and z planes in the padded layout of the row kernels
+    size_t size = gridSize();
+    std::vector<cl_float> rows(3 * ROW_PLANE_SIZE_AT(size), 0.0f);
+    for (std::size_t i = 0; i != nodes.size(); ++i)
+    {
+        std::size_t x = i % size;
+        std::size_t y = i / size;
+        std::size_t id = (y + BORDER) * ROW_PITCH_AT(size) + ROW_VECTOR_WIDTH + x;
+        for (int plane = 0; plane != 3; ++plane)
+            rows[plane * ROW_PLANE_SIZE_AT(size) + id] = nodes[i].s[plane];
+    }
+    return rows;
+}
+
+std::vector<cl_float4> Cloth::fromRows(const std::vector<cl_float>& rows) const
+{
+    size_t size = gridSize();
+    std::vector<cl_float4> nodes(size * size);
+    for (std::size_t i = 0; i != nodes.size(); ++i)
+    {
+        std::size_t x = i % size;
+        std::size_t y = i / size;
+        std::size_t id = (y + BORDER) * ROW_PITCH_AT(size) + ROW_VECTOR_WIDTH + x;
+        for (int plane = 0; plane != 3; ++plane)
+            nodes[i].s[plane] = rows[plane * ROW_PLANE_SIZE_AT(size) + id];
+        nodes[i].s[3] = 1.0f;
+    }
+    return nodes;
+}
+
+void Cloth::refine(cl_mem buffer)
+{
+    cl_kernel kernel = sim.levels[level].refineKernel;
+    setBuffer(kernel, 0, buffer);
+    
     size_t dimensions[] = {CLOTH_SIZE, CLOTH_SIZE};
-    size_t groupSizes[] = {BLOCK_SIZE, BLOCK_SIZE};
-    error = clEnqueueNDRangeKernel(sim.commandQueue, sim.advanceKernel, 2, NULL, dimensions, groupSizes, 0, NULL, NULL);
+    cl_int error = clEnqueueNDRangeKernel(sim.commandQueue, kernel, 2, NULL, dimensions, NULL, 0, NULL, NULL);
     assert(!error);
-    error = clEnqueueNDRangeKernel(sim.commandQueue, sim.stepKernel, 2, NULL, dimensions, groupSizes, 0, NULL, NULL);
+}
+
+void Cloth::setBuffer(cl_kernel kernel, cl_uint index, cl_mem buffer)
+{
+    // the row kernels have no boundary counterpart
+    if (!kernel)
+        return;
+    cl_int error = clSetKernelArg(kernel, index, sizeof(cl_mem), &buffer);
     assert(!error);
-    
-    assert((SOLVER_ITERATIONS % 2) == 1);
-    for (int i = 0; i != SOLVER_ITERATIONS; ++i)
+}
+
+void Cloth::enqueueNodes(cl_kernel kernel, size_t size)
+{
+    cl_int error = 0;
+    if (sim.rowKernels)
+    {
+        size_t dimensions[] = {size / ROW_VECTOR_WIDTH, size};
+        error = clEnqueueNDRangeKernel(sim.commandQueue, kernel, 2, NULL, dimensions, NULL, 0, NULL, NULL);
+    }
+    else
     {
-        bool even = (i % 2) == 0;
-        cl_kernel& kernel = even ? sim.constrainEvenKernel : sim.constrainOddKernel;
+        size_t dimensions[] = {size, size};
+        size_t groupSizes[] = {BLOCK_SIZE, BLOCK_SIZE};
         error = clEnqueueNDRangeKernel(sim.commandQueue, kernel, 2, NULL, dimensions, groupSizes, 0, NULL, NULL);
-        assert(!error);
     }
-    error = clEnqueueNDRangeKernel(sim.commandQueue, sim.normalsKernel, 2, NULL, dimensions, groupSizes, 0, NULL, NULL);
     assert(!error);
+}
+
+void Cloth::enqueueStencil(cl_kernel kernel, cl_kernel boundaryKernel, size_t size)
+{
+    // the row kernels have no boundary kernel, they mask out the missing
+    // neighbours themselves
+    if (!boundaryKernel)
+    {
+        enqueueNodes(kernel, size);
+        return;
+    }
+    
+    // the interior and the boundary strip are written by separate kernels
+    cl_int error = 0;
+    size_t groupSizes[] = {BLOCK_SIZE, BLOCK_SIZE};
+    size_t interiorOffsets[] = {INTERIOR_MARGIN_AT(size), INTERIOR_MARGIN_AT(size)};
+    size_t interiorDimensions[] = {INTERIOR_SIZE_AT(size), INTERIOR_SIZE_AT(size)};
+    size_t boundaryDimensions[] = {BOUNDARY_NODES_AT(size)};
+    error = clEnqueueNDRangeKernel(sim.commandQueue, kernel, 2, interiorOffsets, interiorDimensions, groupSizes, 0, NULL, NULL);
+    assert(!error);
+    error = clEnqueueNDRangeKernel(sim.commandQueue, boundaryKernel, 1, NULL, boundaryDimensions, NULL, 0, NULL, NULL);
+    assert(!error);
+}
+
+void Cloth::step()
+{
+    cl_int error = 0;
+    ClothKernels& kernels = sim.levels[level];
+    size_t size = gridSize();
+    
+    setBuffer(kernels.advanceKernel, 0, oldPositions);
+    setBuffer(kernels.advanceKernel, 1, positions);
+    setBuffer(kernels.advanceKernel, 2, newPositions);
+    enqueueNodes(kernels.advanceKernel, size);
+    
+    // the old positions aren't needed after advance, so the solver
+    // ping-pongs between their buffer and the unconstrained one
+    cl_mem source = newPositions;
+    cl_mem target = oldPositions;
+    for (int i = 0; i != SOLVER_ITERATIONS; ++i)
+    {
+        setBuffer(kernels.constrainKernel, 0, source);
+        setBuffer(kernels.constrainKernel, 1, target);
+        setBuffer(kernels.constrainBoundaryKernel, 0, source);
+        setBuffer(kernels.constrainBoundaryKernel, 1, target);
+        enqueueStencil(kernels.constrainKernel, kernels.constrainBoundaryKernel, size);
+        std::swap(source, target);
+    }
+    
+    // rotate instead of copying: the current positions become the old ones
+    oldPositions = positions;
+    positions = source;
+    newPositions = target;
+    
+    if (level == 0)
+    {
+        setBuffer(kernels.normalsKernel, 0, positions);
+        setBuffer(kernels.normalsBoundaryKernel, 0, positions);
+        enqueueStencil(kernels.normalsKernel, kernels.normalsBoundaryKernel, size);
+    }
+    else
+    {
+        // upsample the coarse grid for display and take the normals there
+        refine(positions);
+        enqueueStencil(sim.displayNormalsKernel, sim.displayNormalsBoundaryKernel, CLOTH_SIZE);
+    }
     
     error = clFinish(sim.commandQueue);
     assert(!error);
@@ -279,7 +549,9 @@ void Cloth::transfer()
     cl_int error = 0;
     size_t verticesSize = CLOTH_SIZE * CLOTH_SIZE * sizeof(cl_float4);
     
-    error = clEnqueueReadBuffer(sim.commandQueue, positions, CL_FALSE, 0, verticesSize, (void*)&result[0], 0, NULL, NULL);
+    // the row kernels and the refinement write float4 vertices out separately
+    cl_mem source = (level == 0 && !sim.rowKernels) ? positions : vertices;
+    error = clEnqueueReadBuffer(sim.commandQueue, source, CL_FALSE, 0, verticesSize, (void*)&result[0], 0, NULL, NULL);
     assert(!error);
     error = clEnqueueReadBuffer(sim.commandQueue, normals, CL_FALSE, 0, verticesSize, (void*)&normalsResult[0], 0, NULL, NULL);
     assert(!error);
@@ -420,6 +692,8 @@ void ClothRenderer::keyboardFunc(unsigned char key, int x, int y)
         self->cloth.reset();
     else if (key == 'n')
         self->showNormals = !self->showNormals;
+    else if (key == 'l')
+        self->cloth.setLevel((self->cloth.getLevel() + 1) % SIMULATION_LEVELS);
     else if (key == 'w')
         self->cameraOffsetPosition.s[1] += 1.0f;
     else if (key == 'a')
@@ -656,7 +930,9 @@ std::string ClothRenderer::makeDebugInfoString() const
         ss << "N/A";
     ss << ", simulation: ";
     ss << lastPhysicsUpdateDuration;
-    ss << " ms, transfer: ";
+    ss << " ms at ";
+    ss << GRID_SIZE_AT(cloth.getLevel()) << "x" << GRID_SIZE_AT(cloth.getLevel());
+    ss << ", transfer: ";
     ss << lastTransferUpdateDuration;
     ss << " ms, rendering: ";
     ss << lastRenderUpdateDuration;